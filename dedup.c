@@ -0,0 +1,174 @@
+#include "dedup.h"
+#include "parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+//----------------------------------------------------------------------
+// typedefs
+
+struct dedup_entry {
+	struct docparser_hash hash;
+	int i_file;
+	char *stream_path; //storage path inside the file, so embedded objects' streams stay apart
+};
+
+//----------------------------------------------------------------------
+// local function declaration
+
+int index_doc(struct doc_file *doc, int i_file, int hash_flags, struct dedup_entry **entries, unsigned int *n_entries);
+int compare_entries(const void *a, const void *b);
+void print_hash(struct docparser_hash *hash, int hash_flags);
+void print_stream_name(char *name);
+
+//----------------------------------------------------------------------
+// implementation
+
+/*
+ * Hashes every stream of every file and reports the streams whose content
+ * occurs more than once across the whole batch.
+ */
+int dedup_report(char **filenames, int n_files, int hash_flags) {
+	struct dedup_entry *entries = NULL;
+	unsigned int n_entries = 0;
+	int rc = 0;
+
+	printf("-- Stream index \n");
+	for (int i_file=0; i_file < n_files; i_file++) {
+		struct doc_file *p_doc = parse_doc(filenames[i_file]);
+		if (!p_doc) {
+			fprintf(stderr, "!! Error parsing file %s \n", filenames[i_file]);
+			fprintf(stderr, "!! %s \n", parser_err_msg);
+			rc = -1;
+			continue;
+		}
+
+		unsigned int i_first = n_entries;
+		if (index_doc(p_doc, i_file, hash_flags, &entries, &n_entries)) {
+			fprintf(stderr, "!! Error hashing file %s \n", filenames[i_file]);
+			fprintf(stderr, "!! %s \n", parser_err_msg);
+			rc = -1;
+
+			//a partly hashed file is skipped as a whole
+			for (unsigned int i=i_first; i < n_entries; i++)
+				free(entries[i].stream_path);
+			n_entries = i_first;
+		}
+		close_doc(p_doc);
+
+		for (unsigned int i=i_first; i < n_entries; i++) {
+			print_hash(&entries[i].hash, hash_flags);
+			printf("\t%s\t", filenames[i_file]);
+			print_stream_name(entries[i].stream_path);
+			printf("\n");
+		}
+	}
+
+	qsort(entries, n_entries, sizeof(struct dedup_entry), compare_entries);
+
+	unsigned int n_unique = 0;
+	unsigned long long total_bytes = 0;
+	unsigned long long dup_bytes = 0;
+
+	printf("-- Duplicates \n");
+	for (unsigned int i=0; i < n_entries; ) {
+		unsigned int j = i + 1;
+		while (j < n_entries && !compare_entries(&entries[i], &entries[j]))
+			j++;
+
+		n_unique++;
+		total_bytes += (j - i) * entries[i].hash.size;
+		if (j - i > 1) {
+			dup_bytes += (j - i - 1) * entries[i].hash.size;
+
+			print_hash(&entries[i].hash, hash_flags);
+			printf("\t%u \n", j - i);
+			for (unsigned int k=i; k < j; k++) {
+				printf("  %s\t", filenames[entries[k].i_file]);
+				print_stream_name(entries[k].stream_path);
+				printf("\n");
+			}
+		}
+
+		i = j;
+	}
+
+	printf("-- Summary \n");
+	printf("  streams: %u \n", n_entries);
+	printf("  unique streams: %u \n", n_unique);
+	printf("  total bytes: %llu \n", total_bytes);
+	printf("  duplicate bytes: %llu \n", dup_bytes);
+
+	for (unsigned int i=0; i < n_entries; i++)
+		free(entries[i].stream_path);
+	free(entries);
+	return rc;
+}
+
+
+//every stream is read once: SummaryInformation was hashed by parse_doc while reading its properties
+int index_doc(struct doc_file *doc, int i_file, int hash_flags, struct dedup_entry **entries, unsigned int *n_entries) {
+	for (unsigned int i=0; i < doc->n_dir_entries; i++) {
+		struct dir_entry *d = &doc->dir_entries[i];
+		if (d->obj_type != DOCPARSER_OBJ_STREAM || !stream_size(doc, d))
+			continue;
+
+		char path[DOCPARSER_MAX_PATH];
+		if (entry_path(doc, i, path, sizeof(path))) {
+			snprintf(parser_err_msg, sizeof(parser_err_msg), "Could not resolve the path of entry #%u", i);
+			return -1;
+		}
+
+		*entries = realloc(*entries, (*n_entries + 1) * sizeof(struct dedup_entry));
+		struct dedup_entry *e = &(*entries)[*n_entries];
+		e->i_file = i_file;
+		if (i == doc->summary_id) {
+			e->hash = doc->summary_hash;
+			if (!(hash_flags & DOCPARSER_HASH_SHA256))
+				memset(e->hash.sha256, 0, sizeof(e->hash.sha256));
+		} else if (hash_stream(doc, d, hash_flags, NULL, NULL, &e->hash)) {
+			return -1;
+		}
+
+		e->stream_path = strdup(path);
+		(*n_entries)++;
+	}
+
+	return 0;
+}
+
+
+//orders by content; hashes that were not computed are zero and compare equal
+int compare_entries(const void *a, const void *b) {
+	const struct docparser_hash *ha = &((const struct dedup_entry *)a)->hash;
+	const struct docparser_hash *hb = &((const struct dedup_entry *)b)->hash;
+
+	if (ha->xxh64 != hb->xxh64)
+		return (ha->xxh64 < hb->xxh64 ? -1 : 1);
+	if (ha->size != hb->size)
+		return (ha->size < hb->size ? -1 : 1);
+
+	return memcmp(ha->sha256, hb->sha256, sizeof(ha->sha256));
+}
+
+
+void print_hash(struct docparser_hash *hash, int hash_flags) {
+	printf("%016"PRIx64, hash->xxh64);
+	if (hash_flags & DOCPARSER_HASH_SHA256) {
+		printf("\t");
+		for (int i=0; i < sizeof(hash->sha256); i++)
+			printf("%02x", hash->sha256[i]);
+	}
+	printf("\t%"PRIu64, hash->size);
+}
+
+
+void print_stream_name(char *name) {
+	for (char *p=name; *p; p++) {
+		if (*p < 0x20 || *p > 0x7E)
+			printf("\\%03o", (unsigned char)*p);
+		else
+			putchar(*p);
+	}
+}
@@ -0,0 +1,11 @@
+#ifndef _DEDUP_H
+#define _DEDUP_H
+
+
+//--------------------------------------------------------------
+// Function declarations
+
+int dedup_report(char **filenames, int n_files, int hash_flags);
+
+
+#endif  //_DEDUP_H
@@ -0,0 +1,164 @@
+#include "docparser.h"
+#include "parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+
+//----------------------------------------------------------------------
+// typedefs
+
+struct read_cbk_data {
+	docparser_read_cbk read_cbk;
+	void *user_data;
+};
+
+//----------------------------------------------------------------------
+// local function declaration
+
+static int forward_read_cbk(char *buffer, unsigned int buffer_size, void *user_data);
+static int copy_versioned(void *to, void *from, size_t from_size);
+
+//----------------------------------------------------------------------
+// implementation
+
+DOCPARSER *docparser_open(const char *filename) {
+	return parse_doc(filename);
+}
+
+
+void docparser_close(DOCPARSER *doc) {
+	if (doc)
+		close_doc(doc);
+}
+
+
+int docparser_stat(DOCPARSER *doc, struct docparser_stat *caller_st) {
+	struct docparser_stat full_st;
+	struct docparser_stat *st = &full_st;
+	memset(st, 0, sizeof(struct docparser_stat));
+	st->major_version = doc->header.major_version;
+	st->sector_size = doc->sector_size;
+
+	//every sector after the header, whether or not the FAT uses it
+	struct stat file_st;
+	if (fstat(fileno(doc->fp), &file_st)) {
+		snprintf(parser_err_msg, sizeof(parser_err_msg), "could not stat file; errno: %d", errno);
+		return -1;
+	}
+	unsigned long long n_units = (file_st.st_size + doc->sector_size - 1) / doc->sector_size;
+	st->n_sectors = (n_units > 1 ? n_units - 1 : 0);
+
+	st->n_properties = doc->n_properties;
+
+	for (unsigned int i=0; i < doc->n_dir_entries; i++) {
+		if (doc->dir_entries[i].obj_type != 0x00)
+			st->n_entries++;
+	}
+
+	return copy_versioned(caller_st, st, sizeof(struct docparser_stat));
+}
+
+
+int docparser_list(DOCPARSER *doc, docparser_list_cbk list_cbk, void *user_data) {
+	for (unsigned int i=0; i < doc->n_dir_entries; i++) {
+		struct dir_entry *d = &doc->dir_entries[i];
+		if (d->obj_type == 0x00)
+			continue;
+
+		struct docparser_entry entry;
+		entry.struct_size = sizeof(struct docparser_entry);
+		utf16_to_ascii(entry.name, d->name, d->name_len);
+		if (entry_path(doc, i, entry.path, sizeof(entry.path)))
+			entry.path[0] = 0x00;
+		entry.obj_type = d->obj_type;
+		entry.size = (d->obj_type == DOCPARSER_OBJ_STORAGE ? 0 : stream_size(doc, d));
+		entry.creat_time = filetime_to_unix(d->creat_time);
+		entry.mod_time = filetime_to_unix(d->mod_time);
+
+		int rc = list_cbk(&entry, user_data);
+		if (rc)
+			return rc;
+	}
+
+	return 0;
+}
+
+
+int docparser_read_stream(DOCPARSER *doc, const char *stream_name, docparser_read_cbk read_cbk, void *user_data) {
+	struct dir_entry *entry = find_stream(doc, stream_name);
+	if (!entry) {
+		snprintf(parser_err_msg, sizeof(parser_err_msg), "Could not find stream: %s", stream_name);
+		return -1;
+	}
+
+	struct read_cbk_data data = { read_cbk, user_data };
+	return read_stream(doc, entry, forward_read_cbk, &data);
+}
+
+
+int docparser_hash_stream(DOCPARSER *doc, const char *stream_name, int hash_flags,
+	docparser_read_cbk read_cbk, void *user_data, struct docparser_hash *hash) {
+	struct dir_entry *entry = find_stream(doc, stream_name);
+	if (!entry) {
+		snprintf(parser_err_msg, sizeof(parser_err_msg), "Could not find stream: %s", stream_name);
+		return -1;
+	}
+
+	struct read_cbk_data data = { read_cbk, user_data };
+	struct docparser_hash full_hash;
+	int rc = hash_stream(doc, entry, hash_flags, (read_cbk ? forward_read_cbk : NULL), &data, &full_hash);
+	if (rc)
+		return rc;
+
+	return copy_versioned(hash, &full_hash, sizeof(struct docparser_hash));
+}
+
+
+/*
+ * Copies a structure the library filled into the caller's, which may be older and shorter.
+ * Both start with struct_size; the caller's says how much room it has.
+ */
+static int copy_versioned(void *to, void *from, size_t from_size) {
+	uint32_t to_size = *(uint32_t *)to;
+	if (to_size < sizeof(uint32_t)) {
+		snprintf(parser_err_msg, sizeof(parser_err_msg), "struct_size is not set");
+		return -1;
+	}
+
+	uint32_t size = (to_size < from_size ? to_size : from_size);
+	*(uint32_t *)from = size;
+	memcpy(to, from, size);
+	return 0;
+}
+
+
+static int forward_read_cbk(char *buffer, unsigned int buffer_size, void *user_data) {
+	struct read_cbk_data *data = (struct read_cbk_data *)user_data;
+	return data->read_cbk(buffer, buffer_size, data->user_data);
+}
+
+
+int docparser_get_property(DOCPARSER *doc, uint32_t propid, char *str_to, size_t str_size) {
+	struct doc_property *prop = find_property(doc, propid);
+	if (!prop) {
+		snprintf(parser_err_msg, sizeof(parser_err_msg), "Property not found: %"PRIu32, propid);
+		return -1;
+	}
+
+	int n = format_property(prop, str_to, str_size);
+	if (n < 0 || n >= str_size) {
+		snprintf(parser_err_msg, sizeof(parser_err_msg), "Could not format property: %"PRIu32"%s", 
+			propid, (n < 0 ? "" : "; buffer too small"));
+		return -1;
+	}
+
+	return 0;
+}
+
+
+const char *docparser_last_error(void) {
+	return parser_err_msg;
+}
@@ -0,0 +1,123 @@
+#ifndef _DOCPARSER_H
+#define _DOCPARSER_H
+
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <time.h>
+
+
+#if defined(__GNUC__) && __GNUC__ >= 4
+#define DOCPARSER_API __attribute__((visibility("default")))
+#else
+#define DOCPARSER_API
+#endif
+
+
+//----------------------------------------------------------------------
+// Constants
+
+//Property ids
+#define PIDSI_CodePage      0x00000001
+#define PIDSI_TITLE         0x00000002
+#define PIDSI_SUBJECT       0x00000003
+#define PIDSI_AUTHOR        0x00000004
+#define PIDSI_KEYWORDS      0x00000005
+#define PIDSI_COMMENTS      0x00000006
+#define PIDSI_TEMPLATE      0x00000007
+#define PIDSI_LASTAUTHOR    0x00000008
+#define PIDSI_REVNUMBER     0x00000009
+#define PIDSI_EDITTIME      0x0000000A
+#define PIDSI_LASTPRINTED   0x0000000B
+#define PIDSI_CREATE_DTM    0x0000000C
+#define PIDSI_LASTSAVE_DTM  0x0000000D
+#define PIDSI_PAGECOUNT     0x0000000E
+#define PIDSI_WORDCOUNT     0x0000000F
+#define PIDSI_CHARCOUNT     0x00000010
+#define PIDSI_THUMBNAIL     0x00000011
+#define PIDSI_APPNAME       0x00000012
+#define PIDSI_DOC_SECURITY  0x00000013
+
+//Stream hash algorithms
+#define DOCPARSER_HASH_XXH64  0x01
+#define DOCPARSER_HASH_SHA256 0x02
+
+//Directory entry object types
+#define DOCPARSER_OBJ_STORAGE 0x01
+#define DOCPARSER_OBJ_STREAM  0x02
+#define DOCPARSER_OBJ_ROOT    0x05
+
+//Longest storage path, terminating null included
+#define DOCPARSER_MAX_PATH 512
+
+
+//----------------------------------------------------------------------
+// Data structures
+
+typedef struct doc_file DOCPARSER; //opaque handle
+
+//Structures start with struct_size, so that fields can be appended in later versions.
+//The caller sets it to sizeof() of the structures it passes in; the library fills only
+//that much and sets struct_size to the number of bytes it filled.
+//In structures the library hands out, struct_size tells which fields are present.
+
+
+struct docparser_stat {
+    uint32_t struct_size;
+    uint16_t major_version;
+    uint32_t sector_size;
+    uint32_t n_sectors; //sectors in the file after the header
+    uint32_t n_entries; //directory entries in use
+    uint32_t n_properties;
+};
+
+
+struct docparser_entry {
+    uint32_t struct_size;
+    char name[64]; //ascii, null terminated
+    char path[DOCPARSER_MAX_PATH]; //storages and name separated by '/', empty for the root or if too long
+    unsigned char obj_type;
+    uint64_t size;
+    time_t creat_time;
+    time_t mod_time;
+};
+
+
+struct docparser_hash {
+    uint32_t struct_size;
+    uint64_t size;
+    uint64_t xxh64;
+    unsigned char sha256[32];
+};
+
+
+//a non-zero return value stops the iteration and is returned to the caller
+typedef int (*docparser_list_cbk)(const struct docparser_entry *entry, void *user_data);
+typedef int (*docparser_read_cbk)(const char *buffer, size_t buffer_size, void *user_data);
+
+
+//--------------------------------------------------------------
+// Function declarations
+//
+// Functions returning int give 0 on success; on failure (NULL or -1)
+// docparser_last_error() describes the error for the calling thread.
+//
+// stream_name is either a bare name, matching a stream directly under the root,
+// or a path as in docparser_entry, optionally with a leading '/', for streams nested in storages.
+
+DOCPARSER_API DOCPARSER *docparser_open(const char *filename);
+DOCPARSER_API void docparser_close(DOCPARSER *doc);
+
+DOCPARSER_API int docparser_stat(DOCPARSER *doc, struct docparser_stat *st);
+DOCPARSER_API int docparser_list(DOCPARSER *doc, docparser_list_cbk list_cbk, void *user_data);
+DOCPARSER_API int docparser_read_stream(DOCPARSER *doc, const char *stream_name,
+	docparser_read_cbk read_cbk, void *user_data);
+DOCPARSER_API int docparser_hash_stream(DOCPARSER *doc, const char *stream_name, int hash_flags,
+	docparser_read_cbk read_cbk, void *user_data, struct docparser_hash *hash);
+//fails rather than truncating when the value does not fit in str_size, terminating null included
+DOCPARSER_API int docparser_get_property(DOCPARSER *doc, uint32_t propid, char *str_to, size_t str_size);
+
+DOCPARSER_API const char *docparser_last_error(void);
+
+
+#endif  //_DOCPARSER_H
@@ -0,0 +1,223 @@
+#include "hash.h"
+#include <string.h>
+
+
+//----------------------------------------------------------------------
+// XXH64
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+
+//input is little endian, as is everything else in the file
+static uint64_t read64(const unsigned char *p) {
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint32_t read32(const unsigned char *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+	acc += input * XXH_PRIME64_2;
+	acc = ROTL64(acc, 31);
+	return acc * XXH_PRIME64_1;
+}
+
+static uint64_t xxh64_merge_round(uint64_t acc, uint64_t val) {
+	acc ^= xxh64_round(0, val);
+	return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+
+void xxh64_init(struct xxh64_state *state, uint64_t seed) {
+	memset(state, 0, sizeof(struct xxh64_state));
+	state->v[0] = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+	state->v[1] = seed + XXH_PRIME64_2;
+	state->v[2] = seed;
+	state->v[3] = seed - XXH_PRIME64_1;
+}
+
+
+void xxh64_update(struct xxh64_state *state, const unsigned char *data, size_t len) {
+	const unsigned char *end = data + len;
+	state->total_len += len;
+
+	if (state->mem_size + len < 32) {
+		memcpy(state->mem + state->mem_size, data, len);
+		state->mem_size += len;
+		return;
+	}
+
+	if (state->mem_size) {
+		unsigned int n_fill = 32 - state->mem_size;
+		memcpy(state->mem + state->mem_size, data, n_fill);
+		for (int i=0; i < 4; i++)
+			state->v[i] = xxh64_round(state->v[i], read64(state->mem + i*8));
+		data += n_fill;
+		state->mem_size = 0;
+	}
+
+	for (; data + 32 <= end; data += 32) {
+		for (int i=0; i < 4; i++)
+			state->v[i] = xxh64_round(state->v[i], read64(data + i*8));
+	}
+
+	if (data < end) {
+		memcpy(state->mem, data, end - data);
+		state->mem_size = end - data;
+	}
+}
+
+
+uint64_t xxh64_digest(struct xxh64_state *state) {
+	uint64_t h;
+	uint64_t *v = state->v;
+
+	if (state->total_len >= 32) {
+		h = ROTL64(v[0], 1) + ROTL64(v[1], 7) + ROTL64(v[2], 12) + ROTL64(v[3], 18);
+		for (int i=0; i < 4; i++)
+			h = xxh64_merge_round(h, v[i]);
+	} else {
+		//seed was stored in v[2]
+		h = v[2] + XXH_PRIME64_5;
+	}
+
+	h += state->total_len;
+
+	const unsigned char *p = state->mem;
+	const unsigned char *end = p + state->mem_size;
+	for (; p + 8 <= end; p += 8) {
+		h ^= xxh64_round(0, read64(p));
+		h = ROTL64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+	}
+	if (p + 4 <= end) {
+		h ^= (uint64_t)read32(p) * XXH_PRIME64_1;
+		h = ROTL64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+		p += 4;
+	}
+	for (; p < end; p++) {
+		h ^= (*p) * XXH_PRIME64_5;
+		h = ROTL64(h, 11) * XXH_PRIME64_1;
+	}
+
+	h ^= h >> 33;
+	h *= XXH_PRIME64_2;
+	h ^= h >> 29;
+	h *= XXH_PRIME64_3;
+	h ^= h >> 32;
+
+	return h;
+}
+
+
+//----------------------------------------------------------------------
+// SHA-256
+
+#define ROTR32(x, r) (((x) >> (r)) | ((x) << (32 - (r))))
+
+static const uint32_t SHA256_K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+
+static void sha256_block(struct sha256_state *state, const unsigned char *block) {
+	uint32_t w[64];
+	for (int i=0; i < 16; i++) {
+		w[i] = ((uint32_t)block[i*4] << 24) | ((uint32_t)block[i*4+1] << 16) 
+			| ((uint32_t)block[i*4+2] << 8) | block[i*4+3];
+	}
+	for (int i=16; i < 64; i++) {
+		uint32_t s0 = ROTR32(w[i-15], 7) ^ ROTR32(w[i-15], 18) ^ (w[i-15] >> 3);
+		uint32_t s1 = ROTR32(w[i-2], 17) ^ ROTR32(w[i-2], 19) ^ (w[i-2] >> 10);
+		w[i] = w[i-16] + s0 + w[i-7] + s1;
+	}
+
+	uint32_t a = state->h[0], b = state->h[1], c = state->h[2], d = state->h[3];
+	uint32_t e = state->h[4], f = state->h[5], g = state->h[6], h = state->h[7];
+
+	for (int i=0; i < 64; i++) {
+		uint32_t s1 = ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25);
+		uint32_t ch = (e & f) ^ (~e & g);
+		uint32_t t1 = h + s1 + ch + SHA256_K[i] + w[i];
+		uint32_t s0 = ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22);
+		uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+		uint32_t t2 = s0 + maj;
+
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+
+	state->h[0] += a; state->h[1] += b; state->h[2] += c; state->h[3] += d;
+	state->h[4] += e; state->h[5] += f; state->h[6] += g; state->h[7] += h;
+}
+
+
+void sha256_init(struct sha256_state *state) {
+	static const uint32_t SHA256_H0[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+
+	memset(state, 0, sizeof(struct sha256_state));
+	memcpy(state->h, SHA256_H0, sizeof(SHA256_H0));
+}
+
+
+void sha256_update(struct sha256_state *state, const unsigned char *data, size_t len) {
+	state->total_len += len;
+
+	if (state->mem_size) {
+		size_t n_fill = 64 - state->mem_size;
+		if (len < n_fill) {
+			memcpy(state->mem + state->mem_size, data, len);
+			state->mem_size += len;
+			return;
+		}
+
+		memcpy(state->mem + state->mem_size, data, n_fill);
+		sha256_block(state, state->mem);
+		data += n_fill;
+		len -= n_fill;
+		state->mem_size = 0;
+	}
+
+	for (; len >= 64; data += 64, len -= 64)
+		sha256_block(state, data);
+
+	memcpy(state->mem, data, len);
+	state->mem_size = len;
+}
+
+
+void sha256_final(struct sha256_state *state, unsigned char digest[32]) {
+	uint64_t bit_len = state->total_len * 8;
+	unsigned char pad[72] = { 0x80 };
+	unsigned int n_pad = (state->mem_size < 56 ? 56 : 120) - state->mem_size;
+
+	for (int i=0; i < 8; i++)
+		pad[n_pad + i] = (unsigned char)(bit_len >> (56 - i*8));
+	sha256_update(state, pad, n_pad + 8);
+
+	for (int i=0; i < 8; i++) {
+		digest[i*4]   = (unsigned char)(state->h[i] >> 24);
+		digest[i*4+1] = (unsigned char)(state->h[i] >> 16);
+		digest[i*4+2] = (unsigned char)(state->h[i] >> 8);
+		digest[i*4+3] = (unsigned char)(state->h[i]);
+	}
+}
@@ -0,0 +1,41 @@
+#ifndef _HASH_H
+#define _HASH_H
+
+
+#include <inttypes.h>
+#include <stddef.h>
+
+
+//----------------------------------------------------------------------
+// Data structures
+
+//streaming XXH64, see https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+struct xxh64_state {
+    uint64_t total_len;
+    uint64_t v[4];
+    unsigned char mem[32];
+    unsigned int mem_size;
+};
+
+//streaming SHA-256, FIPS 180-4
+struct sha256_state {
+    uint32_t h[8];
+    uint64_t total_len;
+    unsigned char mem[64];
+    unsigned int mem_size;
+};
+
+
+//--------------------------------------------------------------
+// Function declarations
+
+void xxh64_init(struct xxh64_state *state, uint64_t seed);
+void xxh64_update(struct xxh64_state *state, const unsigned char *data, size_t len);
+uint64_t xxh64_digest(struct xxh64_state *state);
+
+void sha256_init(struct sha256_state *state);
+void sha256_update(struct sha256_state *state, const unsigned char *data, size_t len);
+void sha256_final(struct sha256_state *state, unsigned char digest[32]);
+
+
+#endif  //_HASH_H
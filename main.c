@@ -1,8 +1,11 @@
 #define MAP_LOD "Games.lod"
 
 #include "parser.h"
+#include "dedup.h"
+#include "watch.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 
 void usage_exit();
@@ -10,12 +13,57 @@ void usage_exit();
 
 
 int main(int argc, char *argv[]) {
-	if (argc <= 1) {
+	bool dedup = false;
+	bool watch = false;
+	int hash_flags = DOCPARSER_HASH_XXH64;
+	struct watch_options watch_opts = { 4, 500, NULL, NULL };
+
+	int opt;
+	while ((opt = getopt(argc, argv, "dswo:u:j:t:")) != -1) {
+		switch (opt) {
+		case 'd':
+			dedup = true;
+			break;
+		case 's':
+			hash_flags |= DOCPARSER_HASH_SHA256;
+			break;
+		case 'w':
+			watch = true;
+			break;
+		case 'o':
+			watch_opts.out_filename = optarg;
+			break;
+		case 'u':
+			watch_opts.socket_path = optarg;
+			break;
+		case 'j':
+		case 't': {
+			int val = atoi(optarg);
+			if (val <= 0)
+				usage_exit(argv, -1);
+			if (opt == 'j')
+				watch_opts.n_workers = val;
+			else
+				watch_opts.debounce_ms = val;
+			break;
+		}
+		default:
+			usage_exit(argv, -1);
+		}
+	}
+
+	if (optind >= argc) {
 		fprintf(stderr, "!! Missing command \n");
 		usage_exit(argv, 0);
 	}
 
-	char *filename = argv[1];
+	if (dedup)
+		exit(dedup_report(&argv[optind], argc - optind, hash_flags) ? -1 : 0);
+
+	if (watch)
+		exit(watch_dirs(&argv[optind], argc - optind, &watch_opts) ? -1 : 0);
+
+	char *filename = argv[optind];
 	printf ("-- Parsing file %s... \n", filename);
 	struct doc_file *p_doc = parse_doc(filename);
 	if (!p_doc) {
@@ -33,6 +81,7 @@ int main(int argc, char *argv[]) {
 	}
 
 	print_header(p_doc);
+	print_properties(p_doc);
 	//print_dir(p_doc);
 	//print_fat(p_doc);
 	close_doc(p_doc);
@@ -42,6 +91,16 @@ int main(int argc, char *argv[]) {
 void usage_exit(char *argv[], int rc) {
 	printf("\n");
 	printf("    Usage: %s   <filename.doc> \n", argv[0]);
+	printf("           %s   -d [-s] <filename.doc>... \n", argv[0]);
+	printf("           %s   -w [-o <out.ndjson> | -u <socket>] [-j <workers>] [-t <debounce ms>] <dir>... \n", argv[0]);
+	printf("\n");
+	printf("    -d   hash every stream and report duplicates across all files (xxh64) \n");
+	printf("    -s   also compute SHA-256 for each stream \n");
+	printf("    -w   watch directory trees and emit one JSON line per new or modified .doc file \n");
+	printf("    -o   append JSON lines to a file instead of stdout \n");
+	printf("    -u   send JSON lines to a listening Unix stream socket \n");
+	printf("    -j   number of worker threads (default 4) \n");
+	printf("    -t   quiet time after the last write before a file is indexed (default 500 ms) \n");
 	printf("\n");
 
 	exit(rc);
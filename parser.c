@@ -1,13 +1,18 @@
 #include "parser.h"
+#include "hash.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <wchar.h>
-#include <iconv.h>
 #include <time.h>
 
 
+//----------------------------------------------------------------------
+// global variables
+
+__thread char parser_err_msg[500];
+
 //----------------------------------------------------------------------
 // typedefs
 
@@ -16,56 +21,73 @@ typedef int (*parse_cbk)(struct doc_file *doc, char *buffer, unsigned int buffer
 //----------------------------------------------------------------------
 // local function declaration
 
-int parse_difat(struct doc_file *doc);
-int parse_fat(struct doc_file *doc);
-int parse_fat_sector(struct doc_file *doc, uint32_t i_sector);
+static int parse_fat(struct doc_file *doc);
+static int parse_fat_sector(struct doc_file *doc, uint32_t i_sector);
+static int parse_minifat(struct doc_file *doc, char *buffer, unsigned int buffer_size);
+static int parse_ministream(struct doc_file *doc);
 
-int parse_chain(struct doc_file *doc, unsigned int start_sector, parse_cbk parse_chain_cbk);
-int parse_stream(struct doc_file *doc, char *chain_name, parse_cbk parse_stream_cbk);
+static int parse_chain(struct doc_file *doc, unsigned int start_sector, parse_cbk parse_chain_cbk);
+static int parse_stream(struct doc_file *doc, struct dir_entry *entry, parse_cbk parse_stream_cbk, 
+	struct docparser_hash *hash);
+static int append_cbk(char *buffer, unsigned int buffer_size, void *user_data);
+static int hash_cbk(char *buffer, unsigned int buffer_size, void *user_data);
 
-int parse_dir(struct doc_file *doc, char *buffer, unsigned int buffer_size);
-int parse_propertyset_stream(struct doc_file *doc, char *buffer, unsigned int buffer_size);
-void parse_property(struct doc_file *doc, uint32_t pid, struct property *p);
+static int parse_dir(struct doc_file *doc, char *buffer, unsigned int buffer_size);
+static void link_parents(struct doc_file *doc);
+static int parse_propertyset_stream(struct doc_file *doc, char *buffer, unsigned int buffer_size);
+static void parse_property(struct doc_file *doc, uint32_t propid, struct property *p, unsigned int max_size);
 
 
-void utf16_to_ascii(char *str_to, char *str_from, int len);
-void decode_str(char *str_to, char *str_from, uint16_t codepage);
-void propid_to_str(char *str_to, uint32_t propid);
-time_t filetime_to_unix(FILETIME filetime);
-char *filetime_to_str(FILETIME filetime);
+static char *decode_str(char *str_from, uint32_t len, uint16_t codepage);
+static char *filetime_to_str(FILETIME filetime);
 
 //----------------------------------------------------------------------
 // implementation
 
-struct doc_file *parse_doc(char *filename) {
-	struct doc_file *doc = (struct doc_file *)malloc(sizeof(struct doc_file));
+struct doc_file *parse_doc(const char *filename) {
+	struct doc_file *doc = (struct doc_file *)calloc(1, sizeof(struct doc_file));
 
 	errno = 0;
 	doc->fp = fopen(filename, "rb");
     if (!doc->fp) {
-            sprintf(parser_err_msg, "could not open file: %s; errno: %d", filename, errno);
+            snprintf(parser_err_msg, sizeof(parser_err_msg), "could not open file: %s; errno: %d", filename, errno);
             free(doc);
             return NULL;
     }
 
 	size_t n_read = fread(&doc->header, sizeof(struct header), 1, doc->fp);
 	if (!n_read) {
-            sprintf(parser_err_msg, "could not read from file: %s", filename);
-		    fclose(doc->fp);
-            free(doc);
+            snprintf(parser_err_msg, sizeof(parser_err_msg), "could not read from file: %s", filename);
+            close_doc(doc);
             return NULL;
     }
 
-	doc->sector_size = 1 << doc->header.sector_shift;
+	//sector sizes below come straight from the header
+	if (!validate_doc(doc)) {
+		close_doc(doc);
+		return NULL;
+	}
 
-    if (parse_fat(doc))
-    	return NULL;
+	doc->sector_size = 1 << doc->header.sector_shift;
+	doc->minisector_size = 1 << doc->header.minisector_shift;
 
-	if (parse_chain(doc, doc->header.dir_sector_start, parse_dir))
+	if (parse_fat(doc) ||
+		parse_chain(doc, doc->header.dir_sector_start, parse_dir) ||
+		parse_ministream(doc)) {
+		close_doc(doc);
 		return NULL;
+	}
 
-	if (parse_stream(doc, "\005SummaryInformation", parse_propertyset_stream))
-		return NULL;
+	//SummaryInformation is optional, without it the document just has no properties
+	doc->summary_id = NOSTREAM;
+	struct dir_entry *summary = find_stream(doc, "\005SummaryInformation");
+	if (summary) {
+		if (parse_stream(doc, summary, parse_propertyset_stream, &doc->summary_hash)) {
+			close_doc(doc);
+			return NULL;
+		}
+		doc->summary_id = summary - doc->dir_entries;
+	}
 
 	return doc;
 }
@@ -77,43 +99,43 @@ bool validate_doc(struct doc_file *doc) {
 
 	struct header *h = &doc->header;
 	if (memcmp(h->signature, DOC_SIGNATURE, sizeof(doc->header.signature))) {
-        sprintf(parser_err_msg, "invalid file signature");
+        snprintf(parser_err_msg, sizeof(parser_err_msg), "invalid file signature");
         return false;
 	}
 
 	if (h->minor_version != 0x003E) {
-        sprintf(parser_err_msg, "invalid minor version");
+        snprintf(parser_err_msg, sizeof(parser_err_msg), "invalid minor version");
         return false;
 	}
 
 	if ((h->major_version != 0x0003) && (h->major_version != 0x0004) ) {
-        sprintf(parser_err_msg, "invalid major version");
+        snprintf(parser_err_msg, sizeof(parser_err_msg), "invalid major version");
         return false;
 	}
 
 	if (h->byte_order != 0xFFFE) {
-        sprintf(parser_err_msg, "invalid byte order");
+        snprintf(parser_err_msg, sizeof(parser_err_msg), "invalid byte order");
         return false;
 	}
 
 	if ( ((h->major_version == 0x0003) && (h->sector_shift != 0x0009)) ||
 		 ((h->major_version == 0x0004) && (h->sector_shift != 0x000C)) ) {
-        sprintf(parser_err_msg, "invalid sector shift");
+        snprintf(parser_err_msg, sizeof(parser_err_msg), "invalid sector shift");
         return false;
 	}
 
 	if (h->minisector_shift != 0x0006) {
-        sprintf(parser_err_msg, "invalid minisector shift");
+        snprintf(parser_err_msg, sizeof(parser_err_msg), "invalid minisector shift");
         return false;
 	}
 
 	if ( (h->major_version == 0x0003) && (h->num_dir_sectors != 0x0000) ) {
-        sprintf(parser_err_msg, "invalid number of directory sectors");
+        snprintf(parser_err_msg, sizeof(parser_err_msg), "invalid number of directory sectors");
         return false;
 	}
 
 	if (h->ministream_cutoff_size != 0x00001000) {
-        sprintf(parser_err_msg, "invalid ministream cutoff size");
+        snprintf(parser_err_msg, sizeof(parser_err_msg), "invalid ministream cutoff size");
         return false;
 	}
 
@@ -122,11 +144,23 @@ bool validate_doc(struct doc_file *doc) {
 
 
 void close_doc(struct doc_file *doc) {
-	fclose(doc->fp);
+	if (doc->fp)
+		fclose(doc->fp);
+
+	for (unsigned int i=0; i < doc->n_properties; i++)
+		free(doc->properties[i].str_val);
+
+	free(doc->properties);
+	free(doc->parent_ids);
+	free(doc->dir_entries);
+	free(doc->ministream_sectors);
+	free(doc->minifat_entries);
+	free(doc->fat_entries);
+	free(doc);
 }
 
 
-int parse_fat(struct doc_file *doc) {
+static int parse_fat(struct doc_file *doc) {
 	unsigned int header_difat_size = 109; //fixed, independent from major version
 	uint32_t *difat = doc->header.difat;
 
@@ -143,14 +177,14 @@ int parse_fat(struct doc_file *doc) {
 }
 
 
-int parse_fat_sector(struct doc_file *doc, uint32_t i_sector) {
+static int parse_fat_sector(struct doc_file *doc, uint32_t i_sector) {
 	unsigned int n_new_entries = doc->sector_size / sizeof(uint32_t);
 	
-	doc->fat_entries = realloc(doc->fat_entries, (doc->n_fat_entries +n_new_entries) * doc->sector_size);
+	doc->fat_entries = realloc(doc->fat_entries, (doc->n_fat_entries +n_new_entries) * sizeof(uint32_t));
 	fseek(doc->fp, (i_sector + 1) * doc->sector_size, SEEK_SET);
 	size_t n_read = fread(&doc->fat_entries[doc->n_fat_entries], doc->sector_size, 1, doc->fp);
 	if (n_read != 1) {
-		sprintf(parser_err_msg, "Could not read FAT sector #%"PRIu32"; n_read=%lu", i_sector, n_read);
+		snprintf(parser_err_msg, sizeof(parser_err_msg), "Could not read FAT sector #%"PRIu32"; n_read=%lu", i_sector, n_read);
 		return -1;
 	}
 
@@ -160,47 +194,294 @@ int parse_fat_sector(struct doc_file *doc, uint32_t i_sector) {
 
 
 
-int parse_stream(struct doc_file *doc, char *stream_name, parse_cbk parse_stream_cbk) {
-	//TODO: support nested dirs
-	printf(" DDD parsing stream \n");
+static int parse_minifat(struct doc_file *doc, char *buffer, unsigned int buffer_size) {
+	doc->n_minifat_entries = buffer_size / sizeof(uint32_t);
+	doc->minifat_entries = malloc(buffer_size);
+	memcpy(doc->minifat_entries, buffer, buffer_size);
+
+	return 0;
+}
+
+
+static int parse_ministream(struct doc_file *doc) {
+	if (doc->header.num_minifat_sectors) {
+		if (parse_chain(doc, doc->header.minifat_sector_start, parse_minifat))
+			return -1;
+	}
+
+	//the mini stream is the content of the root entry
+	if (!doc->n_dir_entries)
+		return 0;
+
+	uint32_t curr_sector = doc->dir_entries[0].start_sector;
+	while (curr_sector != ENDOFCHAIN) {
+		if (curr_sector >= doc->n_fat_entries || doc->n_ministream_sectors >= doc->n_fat_entries) {
+			snprintf(parser_err_msg, sizeof(parser_err_msg), "Broken mini stream chain at sector #%"PRIu32, curr_sector);
+			return -1;
+		}
+
+		doc->ministream_sectors = realloc(doc->ministream_sectors, 
+			(doc->n_ministream_sectors + 1) * sizeof(uint32_t));
+		doc->ministream_sectors[doc->n_ministream_sectors++] = curr_sector;
+		curr_sector = doc->fat_entries[curr_sector];
+	}
+
+	return 0;
+}
+
+
+
+struct stream_buffer {
+	char *data;
+	unsigned int size;
+};
+
+static int append_cbk(char *buffer, unsigned int buffer_size, void *user_data) {
+	struct stream_buffer *sb = (struct stream_buffer *)user_data;
+
+	sb->data = realloc(sb->data, sb->size + buffer_size);
+	memcpy(sb->data + sb->size, buffer, buffer_size);
+	sb->size += buffer_size;
+
+	return 0;
+}
+
+
+/*
+ * Reads the whole stream for parse_stream_cbk, hashing it with every algorithm in the same pass,
+ * so that callers needing its hash later do not read it again.
+ */
+static int parse_stream(struct doc_file *doc, struct dir_entry *entry, parse_cbk parse_stream_cbk, 
+	struct docparser_hash *hash) {
+	struct stream_buffer sb = { NULL, 0 };
+	int rc = hash_stream(doc, entry, DOCPARSER_HASH_XXH64 | DOCPARSER_HASH_SHA256, append_cbk, &sb, hash);
+	if (!rc)
+		rc = parse_stream_cbk(doc, sb.data, sb.size);
+
+	free(sb.data);
+	return rc;
+}
+
+
+/*
+ * stream_name is either a bare name, matching a stream directly under the root,
+ * or a storage path such as "ObjectPool/_1234/\001Ole", with or without a leading '/'.
+ * Streams of the same name inside embedded objects are only reached by their path.
+ */
+struct dir_entry *find_stream(struct doc_file *doc, const char *stream_name) {
+	if (stream_name[0] == '/')
+		stream_name++;
+	bool is_path = (strchr(stream_name, '/') != NULL);
+
 	for (uint32_t i=0; i < doc->n_dir_entries; i++) {
-		char ascii_name[100];
-		utf16_to_ascii(ascii_name, doc->dir_entries[i].name, doc->dir_entries[i].name_len);
+		struct dir_entry *d = &doc->dir_entries[i];
+		if (d->obj_type != DOCPARSER_OBJ_STREAM)
+			continue;
+		if (!is_path && doc->parent_ids[i] != 0)
+			continue;
+
+		char ascii_name[DOCPARSER_MAX_PATH];
+		if (is_path) {
+			if (entry_path(doc, i, ascii_name, sizeof(ascii_name)))
+				continue;
+		} else {
+			utf16_to_ascii(ascii_name, d->name, d->name_len);
+		}
 
-		// int len = strlen(stream_name);
-		// printf(" DDD [%s] <--> [%s] \n", ascii_name, stream_name);
-		// printf(" DDD [0x%x...0x%x] <--> [0x%x...0x%x] \n", ascii_name[0], ascii_name[len], 
-		// 	stream_name[0], stream_name[len]);
+		if (!strcmp(ascii_name, stream_name))
+			return d;
+	}
+
+	return NULL;
+}
 
-		if (!strcmp(ascii_name, stream_name)) {
-			//printf(" DDD stream found starting on sector #%"PRIu32" \n", i);
-			return parse_chain(doc, doc->dir_entries[i].start_sector, parse_stream_cbk);
+
+/*
+ * Writes the names from the top level storage down to the entry, separated by '/',
+ * the root entry excluded. Returns -1 if the path does not fit or the entry is not in the tree.
+ */
+int entry_path(struct doc_file *doc, uint32_t entry_id, char *str_to, size_t str_size) {
+	if (entry_id >= doc->n_dir_entries || !entry_id || !str_size)
+		return -1;
+
+	//collect the ancestors first, the path is written from the top down
+	uint32_t *ids = malloc(doc->n_dir_entries * sizeof(uint32_t));
+	unsigned int n_ids = 0;
+	int rc = 0;
+	for (uint32_t id = entry_id; id; id = doc->parent_ids[id]) {
+		if (id == NOSTREAM || n_ids >= doc->n_dir_entries) {
+			rc = -1;
+			break;
 		}
+		ids[n_ids++] = id;
 	}
 
-	sprintf(parser_err_msg, "Could not find stream: %s", stream_name);
-	return -1;
+	size_t len = 0;
+	str_to[0] = 0x00;
+	for (unsigned int i = n_ids; i > 0 && !rc; i--) {
+		struct dir_entry *d = &doc->dir_entries[ids[i - 1]];
+		char name[64];
+		utf16_to_ascii(name, d->name, d->name_len);
+
+		int n = snprintf(str_to + len, str_size - len, "%s%s", (len ? "/" : ""), name);
+		if (n < 0 || len + n >= str_size)
+			rc = -1;
+		else
+			len += n;
+	}
+
+	free(ids);
+	return rc;
+}
+
+
+unsigned long long stream_size(struct doc_file *doc, struct dir_entry *entry) {
+	//version 3 files may leave garbage in the most significant 32 bits
+	if (doc->header.major_version == 0x0003)
+		return entry->stream_size & 0xFFFFFFFF;
+
+	return entry->stream_size;
 }
 
 
-int parse_chain(struct doc_file *doc, unsigned int start_sector, parse_cbk parse_chain_cbk) {
+/*
+ * Feeds the stream content to read_stream_cbk one (mini)sector at a time, 
+ * following either the FAT or the mini FAT depending on the stream size.
+ * A non-zero return value from the callback stops the read and is passed through.
+ */
+int read_stream(struct doc_file *doc, struct dir_entry *entry, read_cbk read_stream_cbk, void *user_data) {
+	unsigned long long remaining = stream_size(doc, entry);
+	bool is_mini = (remaining < doc->header.ministream_cutoff_size);
+	uint32_t unit_size = (is_mini ? doc->minisector_size : doc->sector_size);
+	uint32_t *chain = (is_mini ? doc->minifat_entries : doc->fat_entries);
+	unsigned int n_chain = (is_mini ? doc->n_minifat_entries : doc->n_fat_entries);
+
+	char *buffer = malloc(unit_size);
+	uint32_t curr_sector = entry->start_sector;
+	unsigned int n_visited = 0;
+	int rc = 0;
+
+	while (remaining > 0) {
+		if (curr_sector >= n_chain || n_visited++ >= n_chain) {
+			snprintf(parser_err_msg, sizeof(parser_err_msg), "Broken %s chain at sector #%"PRIu32, (is_mini ? "mini FAT" : "FAT"), curr_sector);
+			rc = -1;
+			break;
+		}
+
+		long offset;
+		if (is_mini) {
+			uint32_t ministream_offset = curr_sector * unit_size;
+			uint32_t i_sector = ministream_offset / doc->sector_size;
+			if (i_sector >= doc->n_ministream_sectors) {
+				snprintf(parser_err_msg, sizeof(parser_err_msg), "Mini sector #%"PRIu32" outside of the mini stream", curr_sector);
+				rc = -1;
+				break;
+			}
+			offset = (long)(doc->ministream_sectors[i_sector] + 1) * doc->sector_size 
+				+ ministream_offset % doc->sector_size;
+		} else {
+			offset = (long)(curr_sector + 1) * doc->sector_size;
+		}
+
+		unsigned int n_bytes = (remaining < unit_size ? remaining : unit_size);
+		fseek(doc->fp, offset, SEEK_SET);
+		size_t n_read = fread(buffer, n_bytes, 1, doc->fp);
+		if (n_read != 1) {
+			snprintf(parser_err_msg, sizeof(parser_err_msg), "Could not read sector #%"PRIu32"; n_read=%lu", curr_sector, n_read);
+			rc = -1;
+			break;
+		}
+
+		rc = read_stream_cbk(buffer, n_bytes, user_data);
+		if (rc)
+			break;
+
+		remaining -= n_bytes;
+		curr_sector = chain[curr_sector];
+	}
+
+	free(buffer);
+	return rc;
+}
+
+
+struct hash_cbk_data {
+	int hash_flags;
+	struct xxh64_state xxh64;
+	struct sha256_state sha256;
+	read_cbk read_stream_cbk;
+	void *user_data;
+};
+
+static int hash_cbk(char *buffer, unsigned int buffer_size, void *user_data) {
+	struct hash_cbk_data *data = (struct hash_cbk_data *)user_data;
+
+	if (data->hash_flags & DOCPARSER_HASH_XXH64)
+		xxh64_update(&data->xxh64, (unsigned char *)buffer, buffer_size);
+	if (data->hash_flags & DOCPARSER_HASH_SHA256)
+		sha256_update(&data->sha256, (unsigned char *)buffer, buffer_size);
+
+	if (data->read_stream_cbk)
+		return data->read_stream_cbk(buffer, buffer_size, data->user_data);
+
+	return 0;
+}
+
+
+/*
+ * Same as read_stream, hashing each sector as it is read so that no second pass is needed.
+ * read_stream_cbk may be NULL when only the hash is wanted.
+ */
+int hash_stream(struct doc_file *doc, struct dir_entry *entry, int hash_flags, 
+	read_cbk read_stream_cbk, void *user_data, struct docparser_hash *hash) {
+	struct hash_cbk_data data;
+	data.hash_flags = hash_flags;
+	data.read_stream_cbk = read_stream_cbk;
+	data.user_data = user_data;
+	xxh64_init(&data.xxh64, 0);
+	sha256_init(&data.sha256);
+
+	memset(hash, 0, sizeof(struct docparser_hash));
+	int rc = read_stream(doc, entry, hash_cbk, &data);
+	if (rc)
+		return rc;
+
+	hash->size = stream_size(doc, entry);
+	if (hash_flags & DOCPARSER_HASH_XXH64)
+		hash->xxh64 = xxh64_digest(&data.xxh64);
+	if (hash_flags & DOCPARSER_HASH_SHA256)
+		sha256_final(&data.sha256, hash->sha256);
+
+	return 0;
+}
+
+
+static int parse_chain(struct doc_file *doc, unsigned int start_sector, parse_cbk parse_chain_cbk) {
 	unsigned int chain_size = 0;
-	void *chain_buffer = malloc(doc->sector_size);
+	char *chain_buffer = NULL;
 
 	unsigned int curr_sector = start_sector;
 
 	while (true) {
+		if (curr_sector >= doc->n_fat_entries || chain_size >= doc->n_fat_entries) {
+			snprintf(parser_err_msg, sizeof(parser_err_msg), "Broken FAT chain at sector #%"PRIu32, curr_sector);
+			free(chain_buffer);
+			return -1;
+		}
+
 		chain_buffer = realloc(chain_buffer, (++chain_size)*doc->sector_size);
 		fseek(doc->fp, (curr_sector + 1) * doc->sector_size, SEEK_SET);
 		size_t n_read = fread(&chain_buffer[(chain_size-1)*doc->sector_size], doc->sector_size, 1, doc->fp);
 		if (n_read != 1) {
-			sprintf(parser_err_msg, "Could not read sector #%"PRIu32"; n_read=%lu", curr_sector, n_read);
+			snprintf(parser_err_msg, sizeof(parser_err_msg), "Could not read sector #%"PRIu32"; n_read=%lu", curr_sector, n_read);
+			free(chain_buffer);
 			return -1;
 		}
 
-		if (doc->fat_entries[curr_sector] == (uint32_t)0xFFFFFFFE) {
-			//ENDCHAIN
-			return parse_chain_cbk(doc, chain_buffer, chain_size*doc->sector_size);
+		if (doc->fat_entries[curr_sector] == ENDOFCHAIN) {
+			int rc = parse_chain_cbk(doc, chain_buffer, chain_size*doc->sector_size);
+			free(chain_buffer);
+			return rc;
 
 		} else {
 			curr_sector = doc->fat_entries[curr_sector];
@@ -208,40 +489,93 @@ int parse_chain(struct doc_file *doc, unsigned int start_sector, parse_cbk parse
 	}
 }
 
-int parse_dir(struct doc_file *doc, char *buffer, unsigned int buffer_size) {
+static int parse_dir(struct doc_file *doc, char *buffer, unsigned int buffer_size) {
 	doc->n_dir_entries = buffer_size / sizeof(struct dir_entry);
-	doc->dir_entries = (struct dir_entry *)buffer;
+	doc->dir_entries = malloc(buffer_size);
+	memcpy(doc->dir_entries, buffer, buffer_size);
 
+	link_parents(doc);
 	return 0;
 }
 
 
-int parse_propertyset_stream(struct doc_file *doc, char *buffer, unsigned int buffer_size) {
-	printf(" DDD parsing propertyset stream \n");
-	struct property_set_stream *ps_stream = (struct property_set_stream *)buffer;
-    printf(" DDD   byte_order %"PRIu16" \n", ps_stream->byte_order);
-    printf(" DDD   version %"PRIu16" \n", ps_stream->version);
-    printf(" DDD   sys_id %"PRIu32" \n", ps_stream->sys_id);
-    //printf(" DDD   clsid %"PRIu16" \n", ps_stream->clsid);
+/*
+ * The children of a storage form a tree through left_id/right_id, hanging from its child_id.
+ * Walks all of them from the root entry, recording the storage each entry belongs to.
+ * Entries that cannot be reached, or are reached twice in a malformed file, keep NOSTREAM.
+ */
+static void link_parents(struct doc_file *doc) {
+	unsigned int n = doc->n_dir_entries;
+	if (!n)
+		return;
 
-    printf(" DDD num_property_sets: %"PRIu32" \n", ps_stream->num_property_sets);
+	doc->parent_ids = malloc(n * sizeof(uint32_t));
+	for (unsigned int i=0; i < n; i++)
+		doc->parent_ids[i] = NOSTREAM;
+	doc->parent_ids[0] = 0;
+
+	//an entry is pushed only when its parent is first set, so the stack never holds more than n ids
+	uint32_t *stack = malloc(n * sizeof(uint32_t));
+	unsigned int n_stack = 0;
+	stack[n_stack++] = 0;
+
+	while (n_stack > 0) {
+		uint32_t id = stack[--n_stack];
+		struct dir_entry *d = &doc->dir_entries[id];
+
+		uint32_t linked_ids[3] = { d->left_id, d->right_id, d->child_id };
+		for (int i=0; i < 3; i++) {
+			uint32_t l_id = linked_ids[i];
+			if (!l_id || l_id >= n || doc->parent_ids[l_id] != NOSTREAM)
+				continue;
+
+			//siblings share the parent, children of a storage or of the root belong to it
+			bool is_child = (i == 2);
+			if (is_child && d->obj_type != DOCPARSER_OBJ_STORAGE && d->obj_type != DOCPARSER_OBJ_ROOT)
+				continue;
+			if (!is_child && !id)
+				continue;
+
+			doc->parent_ids[l_id] = (is_child ? id : doc->parent_ids[id]);
+			stack[n_stack++] = l_id;
+		}
+	}
+
+	free(stack);
+}
+
+
+static int parse_propertyset_stream(struct doc_file *doc, char *buffer, unsigned int buffer_size) {
+	struct property_set_stream *ps_stream = (struct property_set_stream *)buffer;
+	if (buffer_size < sizeof(struct property_set_stream)) {
+		snprintf(parser_err_msg, sizeof(parser_err_msg), "Property set stream too short");
+		return -1;
+	}
 
 	for (uint32_t i_ps=0; i_ps < ps_stream->num_property_sets; i_ps++) {
-		struct property_set_header *ps_header = (struct property_set_header *)(buffer + sizeof(struct property_set_stream));
-		//printf(" DDD header: %"PRIxx" \n", ps_header->fmtid);
+		unsigned int header_offset = sizeof(struct property_set_stream) + i_ps * sizeof(struct property_set_header);
+		if (header_offset + sizeof(struct property_set_header) > buffer_size)
+			break;
+
+		struct property_set_header *ps_header = (struct property_set_header *)(buffer + header_offset);
+		if (ps_header->offset + sizeof(struct property_set) > buffer_size)
+			continue;
 			
 		struct property_set *ps = (struct property_set *)(buffer + ps_header->offset);
-		printf(" DDD num_props: %"PRIu32" \n", ps->num_props);
+		unsigned int ps_size = buffer_size - ps_header->offset;
+		if (ps->size < ps_size)
+			ps_size = ps->size;
 
 		for (uint32_t i_p=0; i_p < ps->num_props; i_p++) {
-			//struct propid_offset *pid_offset = (struct propid_offset *)(ps + sizeof(struct property_set) 
-			struct propid_offset *pid_offset = (struct propid_offset *)((void *)ps + sizeof(struct property_set) 
-				+ i_p * sizeof(struct propid_offset));
-			if (pid_offset->propid) {
+			unsigned int pid_offset_pos = sizeof(struct property_set) + i_p * sizeof(struct propid_offset);
+			if (pid_offset_pos + sizeof(struct propid_offset) > ps_size)
+				break;
+
+			struct propid_offset *pid_offset = (struct propid_offset *)((void *)ps + pid_offset_pos);
+			//values are at most 8 bytes, except strings whose length is checked on decoding
+			if (pid_offset->propid && pid_offset->offset + sizeof(struct property) + 8 <= ps_size) {
 				struct property *p = (struct property *)((void *)ps + pid_offset->offset);
-				// printf("   DDD %"PRIu32" pid: %"PRIu32" offset: %"PRIu32" \n", 
-				// 	i_p, pid_offset->propid, pid_offset->offset);
-				parse_property(doc, pid_offset->propid, p);
+				parse_property(doc, pid_offset->propid, p, ps_size - pid_offset->offset);
 			}
 		}
 	}
@@ -250,44 +584,84 @@ int parse_propertyset_stream(struct doc_file *doc, char *buffer, unsigned int bu
 }
 
 
-void parse_property(struct doc_file *doc, uint32_t propid, struct property *p) {
-	//printf(" DDD pid: %"PRIu32" type: %"PRIu16" \n", propid, p->type);
-	char prop_name[100];
-	propid_to_str(prop_name, propid);
+static void parse_property(struct doc_file *doc, uint32_t propid, struct property *p, unsigned int max_size) {
 	void *p_val = ((void *)p + sizeof(struct property));
-	char str_val[1000];
-
 
-	uint16_t str_encoding = -1;
 	if (propid == PIDSI_CodePage) {
-		str_encoding = *((uint16_t *)p_val);
+		doc->codepage = *((uint16_t *)p_val);
+	}
+
+	switch (p->type) {
+		case VT_I2:
+		case VT_I4:
+		case VT_LPSTR:
+		case VT_FILETIME:
+			break;
+
+		default:
+			//ignore unknown property types
+			return;
 	}
 
+	doc->properties = realloc(doc->properties, (doc->n_properties + 1) * sizeof(struct doc_property));
+	struct doc_property *prop = &doc->properties[doc->n_properties++];
+	memset(prop, 0, sizeof(struct doc_property));
+	prop->propid = propid;
+	prop->type = p->type;
 
 	switch (p->type) {
 		case VT_I2:
-			//uint16_t *p_val = ((void *)p + sizeof(struct property));
-			//printf("   DDD %s %"PRIu16" \n", prop_name, p, *p_val);
-			printf("   DDD %s = %"PRIu16" \n", prop_name, *((uint16_t *)p_val));
+			prop->int_val = *((int16_t *)p_val);
 			break;
 		case VT_I4:
-			//uint32_t *p_val = ((void *)p + sizeof(struct property));
-			//printf("   DDD %s %"PRIu32" \n", prop_name, p, *p_val);
-			printf("   DDD %s = %"PRIu32" \n", prop_name, (*((uint32_t *)p + sizeof(struct property))));
+			prop->int_val = *((int32_t *)p_val);
 			break;
-		case VT_LPSTR:
-			//skip size field
-			decode_str(str_val, p_val + 4, str_encoding);
-			printf("   DDD %s = %s \n", prop_name, str_val);
+		case VT_LPSTR: {
+			//first 4 bytes are the size field
+			uint32_t len = *((uint32_t *)p_val);
+			uint32_t max_len = max_size - sizeof(struct property) - 4;
+			prop->str_val = decode_str(p_val + 4, (len < max_len ? len : max_len), doc->codepage);
 			break;
+		}
 		case VT_FILETIME:
-			printf("   DDD %s = %s", prop_name, filetime_to_str(*(FILETIME *)p_val));
+			prop->time_val = *((FILETIME *)p_val);
 			break;
+	}
+}
 
-		default:
-			printf("   DDD Unknown property type: %"PRIu16" \n", p->type);
-			//ignore;
+
+struct doc_property *find_property(struct doc_file *doc, uint32_t propid) {
+	for (unsigned int i=0; i < doc->n_properties; i++) {
+		if (doc->properties[i].propid == propid)
+			return &doc->properties[i];
 	}
+
+	return NULL;
+}
+
+
+/*
+ * Returns the length of the text like snprintf, so a value >= str_size means it did not fit
+ * (for dates, the length needed is not known then); -1 for an unknown property type.
+ */
+int format_property(struct doc_property *prop, char *str_to, size_t str_size) {
+	switch (prop->type) {
+		case VT_I2:
+		case VT_I4:
+			return snprintf(str_to, str_size, "%lld", prop->int_val);
+		case VT_LPSTR:
+			return snprintf(str_to, str_size, "%s", prop->str_val);
+		case VT_FILETIME: {
+			time_t ts = filetime_to_unix(prop->time_val);
+			struct tm tm;
+			gmtime_r(&ts, &tm);
+			//strftime gives 0 when the text does not fit, the contents are then undefined
+			size_t n = strftime(str_to, str_size, "%Y-%m-%d %H:%M:%S", &tm);
+			return (n ? n : str_size);
+		}
+	}
+
+	return -1;
 }
 
 
@@ -344,6 +718,19 @@ void print_fat(struct doc_file *doc) {
 }
 
 
+void print_properties(struct doc_file *doc) {
+	printf("-- Properties \n");
+
+	for (unsigned int i=0; i < doc->n_properties; i++) {
+		char prop_name[100];
+		char str_val[1000];
+		propid_to_str(prop_name, doc->properties[i].propid);
+		format_property(&doc->properties[i], str_val, sizeof(str_val));
+		printf("  %s: %s \n", prop_name, str_val);
+	}
+}
+
+
 void print_dir(struct doc_file *doc) {
 
 	printf("-- Directory \n");
@@ -387,6 +774,9 @@ void print_dir(struct doc_file *doc) {
 
 //iconv implementation gives error 22
 void utf16_to_ascii(char *str_to, char *str_from, int len) {
+	if (len > 64)
+		len = 64;
+
 	for (int i=0; i < len/2; i++) {
 		str_to[i] = str_from[i*2];
 	}
@@ -394,9 +784,9 @@ void utf16_to_ascii(char *str_to, char *str_from, int len) {
 	str_to[len/2] = 0x00;
 }
 
-void decode_str(char *str_to, char *str_from, uint16_t codepage) {
+static char *decode_str(char *str_from, uint32_t len, uint16_t codepage) {
 	//TODO: decode CP_WINUNICODE
-	strcpy(str_to, str_from);
+	return strndup(str_from, len);
 }
 
 
@@ -476,7 +866,7 @@ time_t filetime_to_unix(FILETIME filetime) {
 	return (time_t)(ll_filetime / WINDOWS_TICK - SEC_TO_UNIX_EPOCH);
 }
 
-char *filetime_to_str(FILETIME filetime) {
+static char *filetime_to_str(FILETIME filetime) {
 	time_t ts = filetime_to_unix(filetime);
 	return ctime(&ts);
 }
@@ -2,6 +2,7 @@
 #define _PARSER_H
 
 
+#include "docparser.h"
 #include <inttypes.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -34,27 +35,6 @@
 
 
 
-//Property ids
-#define PIDSI_CodePage      0x00000001
-#define PIDSI_TITLE         0x00000002
-#define PIDSI_SUBJECT       0x00000003
-#define PIDSI_AUTHOR        0x00000004
-#define PIDSI_KEYWORDS      0x00000005
-#define PIDSI_COMMENTS      0x00000006
-#define PIDSI_TEMPLATE      0x00000007
-#define PIDSI_LASTAUTHOR    0x00000008
-#define PIDSI_REVNUMBER     0x00000009
-#define PIDSI_EDITTIME      0x0000000A
-#define PIDSI_LASTPRINTED   0x0000000B
-#define PIDSI_CREATE_DTM    0x0000000C
-#define PIDSI_LASTSAVE_DTM  0x0000000D
-#define PIDSI_PAGECOUNT     0x0000000E
-#define PIDSI_WORDCOUNT     0x0000000F
-#define PIDSI_CHARCOUNT     0x00000010
-#define PIDSI_THUMBNAIL     0x00000011
-#define PIDSI_APPNAME       0x00000012
-#define PIDSI_DOC_SECURITY  0x00000013
-
 //Property value types
 #define VT_I2        0x0002
 #define VT_I4        0x0003
@@ -65,7 +45,7 @@
 
 //----------------------------------------------------------------------
 // Global variables
-char parser_err_msg[500];
+extern __thread char parser_err_msg[500];
 
 //----------------------------------------------------------------------
 // Data structures
@@ -155,16 +135,40 @@ struct property {
 
 
 
+struct doc_property {
+    uint32_t propid;
+    uint16_t type;
+    long long int_val;  //VT_I2, VT_I4
+    FILETIME time_val;  //VT_FILETIME
+    char *str_val;      //VT_LPSTR
+};
+
+
 struct doc_file {
     struct header header;
     uint32_t sector_size;
+    uint32_t minisector_size;
     FILE *fp;
 
     uint32_t *fat_entries;
     unsigned int n_fat_entries;
 
+    uint32_t *minifat_entries;
+    unsigned int n_minifat_entries;
+
+    uint32_t *ministream_sectors; //regular sectors holding the mini stream, in chain order
+    unsigned int n_ministream_sectors;
+
     struct dir_entry *dir_entries;
     unsigned int n_dir_entries;
+    uint32_t *parent_ids; //storage holding each entry, NOSTREAM if unreachable from the root
+
+    struct doc_property *properties;
+    unsigned int n_properties;
+    uint16_t codepage;
+
+    uint32_t summary_id; //SummaryInformation entry, NOSTREAM if there is none
+    struct docparser_hash summary_hash; //taken while its properties were read
 };
 
 
@@ -172,13 +176,29 @@ struct doc_file {
 //--------------------------------------------------------------
 // Function declarations
 
-struct doc_file *parse_doc(char *filename);
+typedef int (*read_cbk)(char *buffer, unsigned int buffer_size, void *user_data);
+
+struct doc_file *parse_doc(const char *filename);
 bool validate_doc(struct doc_file *doc);
 void close_doc(struct doc_file *doc);
 
+struct dir_entry *find_stream(struct doc_file *doc, const char *stream_name);
+int entry_path(struct doc_file *doc, uint32_t entry_id, char *str_to, size_t str_size);
+unsigned long long stream_size(struct doc_file *doc, struct dir_entry *entry);
+int read_stream(struct doc_file *doc, struct dir_entry *entry, read_cbk read_stream_cbk, void *user_data);
+int hash_stream(struct doc_file *doc, struct dir_entry *entry, int hash_flags, 
+	read_cbk read_stream_cbk, void *user_data, struct docparser_hash *hash);
+struct doc_property *find_property(struct doc_file *doc, uint32_t propid);
+int format_property(struct doc_property *prop, char *str_to, size_t str_size);
+void propid_to_str(char *str_to, uint32_t propid);
+
+void utf16_to_ascii(char *str_to, char *str_from, int len);
+time_t filetime_to_unix(FILETIME filetime);
+
 void print_header(struct doc_file *doc);
 void print_fat(struct doc_file *doc);
 void print_dir(struct doc_file *doc);
+void print_properties(struct doc_file *doc);
 
 
 #endif  //PARSER_H
@@ -0,0 +1,860 @@
+#include "watch.h"
+#include "parser.h"
+#include "hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef __linux__
+
+#include <stdarg.h>
+#include <strings.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+
+//----------------------------------------------------------------------
+// Constants
+
+#define WATCH_MASK (IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO)
+#define EVENT_BUF_SIZE (64 * (sizeof(struct inotify_event) + NAME_MAX + 1))
+#define INITIAL_CAPACITY 64
+#define SINK_RECONNECT_ATTEMPTS 5
+#define SINK_RECONNECT_DELAY_MS 200
+
+//----------------------------------------------------------------------
+// typedefs
+
+struct out_buffer {
+	char *data;
+	size_t size;
+	size_t capacity;
+};
+
+//a file waiting for its writes to settle, then queued or being indexed
+struct path_entry {
+	char *path;
+	uint64_t hash;
+	struct path_entry *bucket_next;
+
+	long long deadline_ms;  //while pending
+	unsigned int i_heap;    //while pending, position in the deadline heap
+
+	bool in_flight;         //a worker is indexing it
+	bool requeue;           //changed again while in flight
+	struct path_entry *queue_next;
+};
+
+//entries by path, chained; doubles once there are as many entries as buckets
+struct path_table {
+	struct path_entry **buckets;
+	unsigned int n_buckets;
+	unsigned int n_entries;
+};
+
+struct watcher {
+	int fd;
+	char **wd_paths; //indexed by watch descriptor
+	unsigned int n_wd_paths;
+	char **root_paths; //as given on the command line, for rescans
+	int n_roots;
+
+	//used by the event thread only
+	struct path_table pending;
+	struct path_entry **deadline_heap; //pending entries, earliest deadline on top
+	unsigned int n_heap;
+	unsigned int heap_capacity;
+
+	//queued or in flight, under queue_lock
+	struct path_table jobs;
+	struct path_entry *queue_head;
+	struct path_entry *queue_tail;
+	bool stopping;
+	pthread_mutex_t queue_lock;
+	pthread_cond_t queue_cond;
+
+	struct watch_options *opts;
+	int sink_fd;
+	bool sink_failed; //records can no longer be delivered
+	pthread_mutex_t sink_lock;
+	int wake_fd;      //eventfd waking the event thread when the sink fails
+};
+
+struct worker {
+	pthread_t thread;
+	struct watcher *w;
+	struct out_buffer out; //kept across files, so it only grows during warm up
+};
+
+//----------------------------------------------------------------------
+// local function declaration
+
+int open_sink(struct watch_options *opts);
+int add_watch_tree(struct watcher *w, const char *path, bool is_root, long long deadline_ms);
+int set_wd_path(struct watcher *w, int wd, const char *path, struct stat *st);
+void rescan_trees(struct watcher *w, long long deadline_ms);
+void handle_event(struct watcher *w, struct inotify_event *ev, long long deadline_ms);
+bool is_doc_filename(const char *name);
+void touch_pending(struct watcher *w, const char *path, long long deadline_ms);
+void flush_pending(struct watcher *w, long long now_ms);
+void drop_pending(struct watcher *w);
+int next_timeout(struct watcher *w);
+
+uint64_t path_hash(const char *path);
+struct path_entry *table_find(struct path_table *t, const char *path, uint64_t hash);
+void table_insert(struct path_table *t, struct path_entry *e);
+void table_remove(struct path_table *t, struct path_entry *e);
+void heap_push(struct watcher *w, struct path_entry *e);
+struct path_entry *heap_pop(struct watcher *w);
+void heap_sift_down(struct watcher *w, unsigned int i);
+void heap_swap(struct watcher *w, unsigned int i, unsigned int j);
+
+void queue_push(struct watcher *w, struct path_entry *e);
+void queue_append(struct watcher *w, struct path_entry *e);
+struct path_entry *queue_pop(struct watcher *w);
+void queue_done(struct watcher *w, struct path_entry *e);
+void *worker_main(void *arg);
+void index_file(struct worker *wk, const char *path);
+void sink_write(struct watcher *w, const char *data, size_t size);
+
+void buf_printf(struct out_buffer *out, const char *fmt, ...);
+void buf_json_str(struct out_buffer *out, const char *str);
+long long now_ms();
+
+//----------------------------------------------------------------------
+// implementation
+
+/*
+ * Watches the given directory trees and indexes each new or modified .doc file 
+ * once its writes have been quiet for debounce_ms, emitting one JSON line per file.
+ * Runs until SIGINT or SIGTERM.
+ */
+int watch_dirs(char **dirnames, int n_dirs, struct watch_options *opts) {
+	struct watcher w;
+	memset(&w, 0, sizeof(struct watcher));
+	pthread_mutex_init(&w.queue_lock, NULL);
+	pthread_cond_init(&w.queue_cond, NULL);
+	pthread_mutex_init(&w.sink_lock, NULL);
+
+	w.opts = opts;
+	w.sink_fd = open_sink(opts);
+	if (w.sink_fd < 0)
+		return -1;
+
+	w.wake_fd = eventfd(0, EFD_CLOEXEC);
+	if (w.wake_fd < 0) {
+		fprintf(stderr, "!! Could not create eventfd; errno: %d \n", errno);
+		return -1;
+	}
+
+	w.fd = inotify_init1(IN_CLOEXEC);
+	if (w.fd < 0) {
+		fprintf(stderr, "!! Could not initialize inotify; errno: %d \n", errno);
+		return -1;
+	}
+
+	//files changed while no watcher was running are indexed too, once they have settled
+	w.root_paths = dirnames;
+	w.n_roots = n_dirs;
+	long long startup_deadline_ms = now_ms() + opts->debounce_ms;
+	for (int i=0; i < n_dirs; i++) {
+		if (add_watch_tree(&w, dirnames[i], true, startup_deadline_ms))
+			return -1;
+	}
+
+	struct worker *workers = calloc(opts->n_workers, sizeof(struct worker));
+	if (!workers) {
+		fprintf(stderr, "!! Could not allocate %u workers \n", opts->n_workers);
+		return -1;
+	}
+
+	//stop signals are only read from signal_fd, so none can slip in between a check and poll;
+	//the workers inherit the blocked mask
+	sigset_t stop_mask, old_mask;
+	sigemptyset(&stop_mask);
+	sigaddset(&stop_mask, SIGINT);
+	sigaddset(&stop_mask, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &stop_mask, &old_mask);
+	signal(SIGPIPE, SIG_IGN);
+
+	int signal_fd = signalfd(-1, &stop_mask, SFD_CLOEXEC);
+	if (signal_fd < 0) {
+		fprintf(stderr, "!! Could not create signalfd; errno: %d \n", errno);
+		pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+		free(workers);
+		return -1;
+	}
+
+	int rc = 0;
+	bool stop = false;
+	unsigned int n_workers = 0;
+	for (; n_workers < opts->n_workers; n_workers++) {
+		workers[n_workers].w = &w;
+		int err = pthread_create(&workers[n_workers].thread, NULL, worker_main, &workers[n_workers]);
+		if (err) {
+			fprintf(stderr, "!! Could not start worker thread; errno: %d \n", err);
+			//the workers already running are stopped below
+			stop = true;
+			rc = -1;
+			break;
+		}
+	}
+
+	if (!rc)
+		fprintf(stderr, "-- Watching %d directory trees with %u workers \n", n_dirs, n_workers);
+
+	char events[EVENT_BUF_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+	struct pollfd pfds[3] = { { w.fd, POLLIN, 0 }, { signal_fd, POLLIN, 0 }, { w.wake_fd, POLLIN, 0 } };
+
+	while (!stop) {
+		int n_ready = poll(pfds, 3, next_timeout(&w));
+		if (n_ready < 0 && errno != EINTR) {
+			fprintf(stderr, "!! poll failed; errno: %d \n", errno);
+			rc = -1;
+			break;
+		}
+
+		if (n_ready > 0 && (pfds[1].revents & POLLIN)) {
+			struct signalfd_siginfo si;
+			if (read(signal_fd, &si, sizeof(si)) == sizeof(si))
+				stop = true;
+		}
+
+		if (n_ready > 0 && (pfds[2].revents & POLLIN)) {
+			fprintf(stderr, "!! The sink failed, stopping \n");
+			stop = true;
+			rc = -1;
+		}
+
+		if (n_ready > 0 && (pfds[0].revents & POLLIN)) {
+			long long deadline_ms = now_ms() + opts->debounce_ms;
+			ssize_t len = read(w.fd, events, sizeof(events));
+			for (char *p = events; len > 0 && p < events + len; ) {
+				struct inotify_event *ev = (struct inotify_event *)p;
+				handle_event(&w, ev, deadline_ms);
+				p += sizeof(struct inotify_event) + ev->len;
+			}
+		}
+
+		flush_pending(&w, now_ms());
+	}
+
+	//files still being written would give error records; the startup scan of the next run picks them up
+	drop_pending(&w);
+
+	pthread_mutex_lock(&w.queue_lock);
+	w.stopping = true;
+	pthread_cond_broadcast(&w.queue_cond);
+	pthread_mutex_unlock(&w.queue_lock);
+
+	for (unsigned int i=0; i < n_workers; i++) {
+		pthread_join(workers[i].thread, NULL);
+		free(workers[i].out.data);
+	}
+	free(workers);
+
+	for (unsigned int i=0; i < w.n_wd_paths; i++)
+		free(w.wd_paths[i]);
+	free(w.wd_paths);
+	free(w.pending.buckets);
+	free(w.deadline_heap);
+	free(w.jobs.buckets);
+	close(w.fd);
+	close(w.wake_fd);
+	close(signal_fd);
+	pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+	if (w.sink_fd >= 0 && w.sink_fd != STDOUT_FILENO)
+		close(w.sink_fd);
+
+	fprintf(stderr, "-- Stopped watching \n");
+	return rc;
+}
+
+
+int open_sink(struct watch_options *opts) {
+	if (opts->socket_path) {
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if (strlen(opts->socket_path) >= sizeof(addr.sun_path)) {
+			fprintf(stderr, "!! Socket path too long: %s \n", opts->socket_path);
+			return -1;
+		}
+		strcpy(addr.sun_path, opts->socket_path);
+
+		int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+			fprintf(stderr, "!! Could not connect to socket: %s; errno: %d \n", opts->socket_path, errno);
+			if (fd >= 0)
+				close(fd);
+			return -1;
+		}
+		return fd;
+	}
+
+	if (opts->out_filename) {
+		int fd = open(opts->out_filename, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		if (fd < 0)
+			fprintf(stderr, "!! Could not open output file: %s; errno: %d \n", opts->out_filename, errno);
+		return fd;
+	}
+
+	return STDOUT_FILENO;
+}
+
+
+/*
+ * Watches path and every directory below it. Symbolic links are not followed, except for
+ * a root given on the command line. With a non-zero deadline_ms the .doc files found are
+ * marked pending, for files that landed before the watch was in place.
+ */
+int add_watch_tree(struct watcher *w, const char *path, bool is_root, long long deadline_ms) {
+	struct stat st;
+	if ((is_root ? stat(path, &st) : lstat(path, &st)) || !S_ISDIR(st.st_mode)) {
+		if (is_root)
+			fprintf(stderr, "!! Not a directory: %s \n", path);
+		return -1;
+	}
+
+	uint32_t mask = WATCH_MASK | IN_ONLYDIR | (is_root ? 0 : IN_DONT_FOLLOW);
+	int wd = inotify_add_watch(w->fd, path, mask);
+	if (wd < 0) {
+		fprintf(stderr, "!! Could not watch directory: %s; errno: %d \n", path, errno);
+		return -1;
+	}
+
+	//already watched under another name, its content is covered there
+	if (set_wd_path(w, wd, path, &st))
+		return 0;
+
+	DIR *dir = opendir(path);
+	if (!dir)
+		return 0;
+
+	struct dirent *de;
+	while ((de = readdir(dir))) {
+		if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+			continue;
+
+		char child_path[PATH_MAX];
+		if (snprintf(child_path, sizeof(child_path), "%s/%s", path, de->d_name) >= sizeof(child_path))
+			continue;
+
+		struct stat child_st;
+		if (lstat(child_path, &child_st))
+			continue;
+
+		if (S_ISDIR(child_st.st_mode))
+			add_watch_tree(w, child_path, false, deadline_ms);
+		else if (deadline_ms && S_ISREG(child_st.st_mode) && is_doc_filename(de->d_name))
+			touch_pending(w, child_path, deadline_ms);
+	}
+
+	closedir(dir);
+	return 0;
+}
+
+
+/*
+ * Records the path of a watch descriptor. inotify hands back the known descriptor when the
+ * directory is already watched; its path is replaced only if the old one is gone (a rename).
+ * Returns -1 if the directory is still reachable under its old path.
+ */
+int set_wd_path(struct watcher *w, int wd, const char *path, struct stat *st) {
+	if (wd >= w->n_wd_paths) {
+		w->wd_paths = realloc(w->wd_paths, (wd + 1) * sizeof(char *));
+		memset(&w->wd_paths[w->n_wd_paths], 0, (wd + 1 - w->n_wd_paths) * sizeof(char *));
+		w->n_wd_paths = wd + 1;
+	}
+
+	char *old_path = w->wd_paths[wd];
+	if (old_path && strcmp(old_path, path)) {
+		struct stat old_st;
+		if (!stat(old_path, &old_st) && old_st.st_dev == st->st_dev && old_st.st_ino == st->st_ino)
+			return -1;
+	}
+
+	if (!old_path || strcmp(old_path, path)) {
+		free(old_path);
+		w->wd_paths[wd] = strdup(path);
+	}
+	return 0;
+}
+
+
+//after an overflow the missed events are unknown, so every .doc file is looked at again
+void rescan_trees(struct watcher *w, long long deadline_ms) {
+	fprintf(stderr, "!! inotify queue overflow, rescanning the watched trees \n");
+	for (int i=0; i < w->n_roots; i++)
+		add_watch_tree(w, w->root_paths[i], true, deadline_ms);
+}
+
+
+void handle_event(struct watcher *w, struct inotify_event *ev, long long deadline_ms) {
+	if (ev->mask & IN_Q_OVERFLOW) {
+		rescan_trees(w, deadline_ms);
+		return;
+	}
+
+	if (ev->mask & IN_IGNORED) {
+		if (ev->wd < w->n_wd_paths) {
+			free(w->wd_paths[ev->wd]);
+			w->wd_paths[ev->wd] = NULL;
+		}
+		return;
+	}
+
+	if (!ev->len || ev->wd >= w->n_wd_paths || !w->wd_paths[ev->wd])
+		return;
+
+	char path[PATH_MAX];
+	if (snprintf(path, sizeof(path), "%s/%s", w->wd_paths[ev->wd], ev->name) >= sizeof(path))
+		return;
+
+	if (ev->mask & IN_ISDIR) {
+		if (ev->mask & (IN_CREATE | IN_MOVED_TO))
+			add_watch_tree(w, path, false, deadline_ms);
+		return;
+	}
+
+	if (is_doc_filename(ev->name))
+		touch_pending(w, path, deadline_ms);
+}
+
+
+bool is_doc_filename(const char *name) {
+	//skip hidden files and Word lock files
+	if (name[0] == '.' || !strncmp(name, "~$", 2))
+		return false;
+
+	size_t len = strlen(name);
+	return (len > 4 && !strcasecmp(name + len - 4, ".doc"));
+}
+
+
+void touch_pending(struct watcher *w, const char *path, long long deadline_ms) {
+	uint64_t hash = path_hash(path);
+	struct path_entry *e = table_find(&w->pending, path, hash);
+	if (e) {
+		//deadlines only move later, so the entry can only sink in the heap
+		e->deadline_ms = deadline_ms;
+		heap_sift_down(w, e->i_heap);
+		return;
+	}
+
+	e = calloc(1, sizeof(struct path_entry));
+	e->path = strdup(path);
+	e->hash = hash;
+	e->deadline_ms = deadline_ms;
+	table_insert(&w->pending, e);
+	heap_push(w, e);
+}
+
+
+void flush_pending(struct watcher *w, long long now_ms) {
+	while (w->n_heap > 0 && w->deadline_heap[0]->deadline_ms <= now_ms) {
+		struct path_entry *e = heap_pop(w);
+		table_remove(&w->pending, e);
+		queue_push(w, e);
+	}
+}
+
+
+void drop_pending(struct watcher *w) {
+	while (w->n_heap > 0) {
+		struct path_entry *e = heap_pop(w);
+		table_remove(&w->pending, e);
+		free(e->path);
+		free(e);
+	}
+}
+
+
+//milliseconds until the earliest deadline, -1 to wait for events only
+int next_timeout(struct watcher *w) {
+	if (!w->n_heap)
+		return -1;
+
+	long long wait_ms = w->deadline_heap[0]->deadline_ms - now_ms();
+	if (wait_ms < 0)
+		return 0;
+	return (wait_ms > INT_MAX ? INT_MAX : wait_ms);
+}
+
+
+
+uint64_t path_hash(const char *path) {
+	struct xxh64_state state;
+	xxh64_init(&state, 0);
+	xxh64_update(&state, (const unsigned char *)path, strlen(path));
+	return xxh64_digest(&state);
+}
+
+
+struct path_entry *table_find(struct path_table *t, const char *path, uint64_t hash) {
+	if (!t->n_buckets)
+		return NULL;
+
+	for (struct path_entry *e = t->buckets[hash % t->n_buckets]; e; e = e->bucket_next) {
+		if (e->hash == hash && !strcmp(e->path, path))
+			return e;
+	}
+
+	return NULL;
+}
+
+
+void table_insert(struct path_table *t, struct path_entry *e) {
+	if (t->n_entries >= t->n_buckets) {
+		unsigned int n_buckets = (t->n_buckets ? t->n_buckets * 2 : INITIAL_CAPACITY);
+		struct path_entry **buckets = calloc(n_buckets, sizeof(struct path_entry *));
+		for (unsigned int i=0; i < t->n_buckets; i++) {
+			while (t->buckets[i]) {
+				struct path_entry *moved = t->buckets[i];
+				t->buckets[i] = moved->bucket_next;
+				moved->bucket_next = buckets[moved->hash % n_buckets];
+				buckets[moved->hash % n_buckets] = moved;
+			}
+		}
+		free(t->buckets);
+		t->buckets = buckets;
+		t->n_buckets = n_buckets;
+	}
+
+	struct path_entry **bucket = &t->buckets[e->hash % t->n_buckets];
+	e->bucket_next = *bucket;
+	*bucket = e;
+	t->n_entries++;
+}
+
+
+void table_remove(struct path_table *t, struct path_entry *e) {
+	for (struct path_entry **p = &t->buckets[e->hash % t->n_buckets]; *p; p = &(*p)->bucket_next) {
+		if (*p == e) {
+			*p = e->bucket_next;
+			e->bucket_next = NULL;
+			t->n_entries--;
+			return;
+		}
+	}
+}
+
+
+void heap_push(struct watcher *w, struct path_entry *e) {
+	if (w->n_heap >= w->heap_capacity) {
+		w->heap_capacity = (w->heap_capacity ? w->heap_capacity * 2 : INITIAL_CAPACITY);
+		w->deadline_heap = realloc(w->deadline_heap, w->heap_capacity * sizeof(struct path_entry *));
+	}
+
+	unsigned int i = w->n_heap++;
+	w->deadline_heap[i] = e;
+	e->i_heap = i;
+
+	while (i > 0 && w->deadline_heap[(i - 1) / 2]->deadline_ms > e->deadline_ms) {
+		heap_swap(w, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+
+struct path_entry *heap_pop(struct watcher *w) {
+	struct path_entry *top = w->deadline_heap[0];
+	if (--w->n_heap > 0) {
+		heap_swap(w, 0, w->n_heap);
+		heap_sift_down(w, 0);
+	}
+
+	return top;
+}
+
+
+void heap_sift_down(struct watcher *w, unsigned int i) {
+	while (true) {
+		unsigned int i_min = i;
+		for (unsigned int i_child = 2 * i + 1; i_child <= 2 * i + 2 && i_child < w->n_heap; i_child++) {
+			if (w->deadline_heap[i_child]->deadline_ms < w->deadline_heap[i_min]->deadline_ms)
+				i_min = i_child;
+		}
+
+		if (i_min == i)
+			return;
+		heap_swap(w, i, i_min);
+		i = i_min;
+	}
+}
+
+
+void heap_swap(struct watcher *w, unsigned int i, unsigned int j) {
+	struct path_entry *e = w->deadline_heap[i];
+	w->deadline_heap[i] = w->deadline_heap[j];
+	w->deadline_heap[j] = e;
+	w->deadline_heap[i]->i_heap = i;
+	w->deadline_heap[j]->i_heap = j;
+}
+
+
+
+/*
+ * Takes ownership of e. A path is never indexed by two workers at once: if it is being 
+ * indexed already it goes back in the queue when that finishes, so its latest record is written last.
+ */
+void queue_push(struct watcher *w, struct path_entry *e) {
+	pthread_mutex_lock(&w->queue_lock);
+
+	struct path_entry *job = table_find(&w->jobs, e->path, e->hash);
+	if (job) {
+		//if not picked up yet, the worker will see the latest content anyway
+		if (job->in_flight)
+			job->requeue = true;
+
+		pthread_mutex_unlock(&w->queue_lock);
+		free(e->path);
+		free(e);
+		return;
+	}
+
+	table_insert(&w->jobs, e);
+	queue_append(w, e);
+	pthread_mutex_unlock(&w->queue_lock);
+}
+
+
+//queue_lock must be held
+void queue_append(struct watcher *w, struct path_entry *e) {
+	e->in_flight = false;
+	e->requeue = false;
+	e->queue_next = NULL;
+	if (w->queue_tail)
+		w->queue_tail->queue_next = e;
+	else
+		w->queue_head = e;
+	w->queue_tail = e;
+
+	pthread_cond_signal(&w->queue_cond);
+}
+
+
+struct path_entry *queue_pop(struct watcher *w) {
+	pthread_mutex_lock(&w->queue_lock);
+
+	while (!w->queue_head && !w->stopping)
+		pthread_cond_wait(&w->queue_cond, &w->queue_lock);
+
+	struct path_entry *e = w->queue_head;
+	if (e) {
+		w->queue_head = e->queue_next;
+		if (!w->queue_head)
+			w->queue_tail = NULL;
+		e->in_flight = true;
+	}
+
+	pthread_mutex_unlock(&w->queue_lock);
+	return e;
+}
+
+
+void queue_done(struct watcher *w, struct path_entry *e) {
+	pthread_mutex_lock(&w->queue_lock);
+
+	if (e->requeue) {
+		queue_append(w, e);
+		e = NULL;
+	} else {
+		table_remove(&w->jobs, e);
+	}
+
+	pthread_mutex_unlock(&w->queue_lock);
+
+	if (e) {
+		free(e->path);
+		free(e);
+	}
+}
+
+
+void *worker_main(void *arg) {
+	struct worker *wk = (struct worker *)arg;
+
+	struct path_entry *job;
+	while ((job = queue_pop(wk->w))) {
+		index_file(wk, job->path);
+		queue_done(wk->w, job);
+	}
+
+	return NULL;
+}
+
+
+void index_file(struct worker *wk, const char *path) {
+	struct out_buffer *out = &wk->out;
+	out->size = 0;
+
+	buf_printf(out, "{\"file\":");
+	buf_json_str(out, path);
+
+	struct stat st;
+	struct doc_file *doc = NULL;
+	if (stat(path, &st)) {
+		//removed or renamed away while waiting in the queue
+		buf_printf(out, ",\"error\":\"could not stat file; errno: %d\"", errno);
+	} else if (!(doc = parse_doc(path))) {
+		buf_printf(out, ",\"error\":");
+		buf_json_str(out, parser_err_msg);
+	}
+
+	if (doc) {
+		buf_printf(out, ",\"size\":%lld,\"mtime\":%lld,\"major_version\":%"PRIu16, 
+			(long long)st.st_size, (long long)st.st_mtime, doc->header.major_version);
+
+		buf_printf(out, ",\"properties\":{");
+		for (unsigned int i=0; i < doc->n_properties; i++) {
+			struct doc_property *prop = &doc->properties[i];
+			char prop_name[100];
+			char str_val[1000];
+			propid_to_str(prop_name, prop->propid);
+
+			buf_printf(out, "%s\"%s\":", (i ? "," : ""), prop_name);
+			if (prop->type == VT_I2 || prop->type == VT_I4) {
+				buf_printf(out, "%lld", prop->int_val);
+			} else {
+				format_property(prop, str_val, sizeof(str_val));
+				buf_json_str(out, str_val);
+			}
+		}
+
+		buf_printf(out, "},\"streams\":[");
+		bool first = true;
+		for (unsigned int i=0; i < doc->n_dir_entries; i++) {
+			struct dir_entry *d = &doc->dir_entries[i];
+			if (d->obj_type != DOCPARSER_OBJ_STREAM)
+				continue;
+
+			//the storage path tells apart the streams of different embedded objects
+			char name[DOCPARSER_MAX_PATH];
+			if (entry_path(doc, i, name, sizeof(name)))
+				utf16_to_ascii(name, d->name, d->name_len);
+			buf_printf(out, "%s{\"name\":", (first ? "" : ","));
+			buf_json_str(out, name);
+			buf_printf(out, ",\"size\":%llu}", stream_size(doc, d));
+			first = false;
+		}
+		buf_printf(out, "]");
+
+		close_doc(doc);
+	}
+
+	buf_printf(out, "}\n");
+	sink_write(wk->w, out->data, out->size);
+}
+
+
+/*
+ * One write per line under the lock, so that lines from different workers never interleave.
+ * When the socket reader goes away the line is sent again on a new connection; if that
+ * cannot be made, or any other write fails, the event thread is woken up to stop watching.
+ */
+void sink_write(struct watcher *w, const char *data, size_t size) {
+	pthread_mutex_lock(&w->sink_lock);
+
+	size_t n_done = 0;
+	bool reconnected = false;
+	while (n_done < size && !w->sink_failed) {
+		ssize_t n_written = write(w->sink_fd, data + n_done, size - n_done);
+		if (n_written >= 0) {
+			n_done += n_written;
+			continue;
+		}
+		if (errno == EINTR)
+			continue;
+
+		if (w->opts->socket_path && (errno == EPIPE || errno == ECONNRESET) && !reconnected) {
+			fprintf(stderr, "!! Sink socket closed, reconnecting \n");
+			close(w->sink_fd);
+			w->sink_fd = open_sink(w->opts);
+			for (int i=1; i < SINK_RECONNECT_ATTEMPTS && w->sink_fd < 0; i++) {
+				usleep(SINK_RECONNECT_DELAY_MS * 1000);
+				w->sink_fd = open_sink(w->opts);
+			}
+
+			reconnected = true;
+			n_done = 0;  //the reader of the old connection never saw the end of the line
+			if (w->sink_fd >= 0)
+				continue;
+		} else {
+			fprintf(stderr, "!! Could not write to sink; errno: %d \n", errno);
+		}
+
+		w->sink_failed = true;
+		uint64_t one = 1;
+		if (write(w->wake_fd, &one, sizeof(one)) < 0)
+			fprintf(stderr, "!! Could not wake the event thread; errno: %d \n", errno);
+	}
+
+	pthread_mutex_unlock(&w->sink_lock);
+}
+
+
+
+void buf_printf(struct out_buffer *out, const char *fmt, ...) {
+	va_list args;
+
+	while (true) {
+		va_start(args, fmt);
+		int n = vsnprintf(out->data + out->size, out->capacity - out->size, fmt, args);
+		va_end(args);
+
+		if (n >= 0 && out->size + n < out->capacity) {
+			out->size += n;
+			return;
+		}
+
+		out->capacity = (out->capacity ? out->capacity * 2 : 4096);
+		if (n >= 0 && out->capacity < out->size + n + 1)
+			out->capacity = out->size + n + 1;
+		out->data = realloc(out->data, out->capacity);
+	}
+}
+
+
+//bytes above 0x7F are taken as Latin-1, the closest match to the usual 1252 code page
+void buf_json_str(struct out_buffer *out, const char *str) {
+	buf_printf(out, "\"");
+	for (const unsigned char *p = (const unsigned char *)str; *p; p++) {
+		if (*p == '"' || *p == '\\')
+			buf_printf(out, "\\%c", *p);
+		else if (*p < 0x20 || *p > 0x7E)
+			buf_printf(out, "\\u%04x", *p);
+		else
+			buf_printf(out, "%c", *p);
+	}
+	buf_printf(out, "\"");
+}
+
+
+long long now_ms() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+#else  //__linux__
+
+int watch_dirs(char **dirnames, int n_dirs, struct watch_options *opts) {
+	fprintf(stderr, "!! Watch mode needs inotify and is only available on Linux \n");
+	return -1;
+}
+
+#endif  //__linux__
@@ -0,0 +1,22 @@
+#ifndef _WATCH_H
+#define _WATCH_H
+
+
+//----------------------------------------------------------------------
+// Data structures
+
+struct watch_options {
+    unsigned int n_workers;
+    unsigned int debounce_ms;  //quiet time after the last write before a file is indexed
+    char *out_filename;        //NDJSON file to append to; stdout if neither is set
+    char *socket_path;         //Unix stream socket to send NDJSON lines to
+};
+
+
+//--------------------------------------------------------------
+// Function declarations
+
+int watch_dirs(char **dirnames, int n_dirs, struct watch_options *opts);
+
+
+#endif  //_WATCH_H